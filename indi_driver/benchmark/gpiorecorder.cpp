@@ -0,0 +1,313 @@
+/*
+    Recording GPIO backend for benchmarking the MUP Astro CAT driver.
+
+    Copyright © 2016 Gary Preston (gary@mups.co.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Notes:
+        - Implements the subset of the wiringPi API used by the driver, link
+          in place of libwiringPi.
+        - The nHOME ISR is invoked synchronously from the STEP write unless a
+          delay is set, in which case a dispatch thread invokes it later.
+*/
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <wiringPi.h>
+
+#include "gpiorecorder.h"
+
+//////////////////////////////////////////////////////////////////////
+// Constants
+//////////////////////////////////////////////////////////////////////
+
+// Must match the BCM pins used by motorcontroller.cpp
+const int PIN_RESET = 20;
+const int PIN_DIR = 19;
+const int PIN_STEP = 13;
+const int PIN_nHOME = 12;
+const int PIN_nFAULT = 6;
+
+// Full step mode
+const int STEPS_PER_HOME_CYCLE = 4;
+
+//////////////////////////////////////////////////////////////////////
+// Recorder State
+//////////////////////////////////////////////////////////////////////
+
+static std::mutex sgLock;
+static std::condition_variable sgStepCondition;
+static std::vector<GPIORecorder::StepEdge> sgSteps;
+static int sgStepLevel = 0;
+static int sgDirLevel = 0;
+static int sgIndexerState = 0;
+static void (*sgHomeISR)(void) = nullptr;
+static int64_t sgIndexerSteps = 0;
+
+// Fault injection
+static size_t sgDropAfter = 0;
+static size_t sgDropCount = 0;
+static std::chrono::microseconds sgHomeISRDelay {0};
+static std::deque<std::chrono::steady_clock::time_point> sgDeferredHomeISRs;
+static std::condition_variable sgDeferredCondition;
+static std::thread sgDeferredThread;
+static bool sgStopDeferredThread = false;
+
+//////////////////////////////////////////////////////////////////////
+// Deferred ISR Dispatch
+//////////////////////////////////////////////////////////////////////
+
+// Invoke deferred nHOME ISRs in edge order once due.
+static void _DispatchDeferredHomeISRs()
+{
+    std::unique_lock<std::mutex> lock(sgLock);
+
+    for (;;)
+    {
+        if (sgDeferredHomeISRs.empty())
+        {
+            if (sgStopDeferredThread)
+                return;
+
+            sgDeferredCondition.wait(lock);
+            continue;
+        }
+
+        const auto due = sgDeferredHomeISRs.front();
+        if (std::chrono::steady_clock::now() < due)
+        {
+            sgDeferredCondition.wait_until(lock, due);
+            continue;
+        }
+
+        sgDeferredHomeISRs.pop_front();
+        void (*isr)(void) = sgHomeISR;
+
+        lock.unlock();
+        if (isr)
+            isr();
+        lock.lock();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// wiringPi API
+//////////////////////////////////////////////////////////////////////
+
+int wiringPiSetupGpio(void)
+{
+    return 0;
+}
+
+void pinMode(int pin, int mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(int pin, int value)
+{
+    void (*isr)(void) = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(sgLock);
+
+        if (pin == PIN_DIR)
+        {
+            sgDirLevel = value;
+        }
+        else if (pin == PIN_RESET && value)
+        {
+            sgIndexerState = 0;
+        }
+        else if (pin == PIN_STEP)
+        {
+            if (value && !sgStepLevel)
+            {
+                const bool clockwise = sgDirLevel != 0;
+                sgSteps.push_back({ GPIORecorder::NowMicroseconds(), clockwise });
+
+                if (sgDropCount > 0 && sgDropAfter == 0)
+                {
+                    sgDropCount--;
+                }
+                else
+                {
+                    if (sgDropAfter > 0)
+                        sgDropAfter--;
+
+                    sgIndexerSteps += clockwise ? 1 : -1;
+                    sgIndexerState = (sgIndexerState + (clockwise ? 1 : -1) + STEPS_PER_HOME_CYCLE) % STEPS_PER_HOME_CYCLE;
+
+                    if (sgIndexerState == 0 && sgHomeISRDelay.count() > 0)
+                    {
+                        sgDeferredHomeISRs.push_back(std::chrono::steady_clock::now() + sgHomeISRDelay);
+                        sgDeferredCondition.notify_one();
+                    }
+                    else if (sgIndexerState == 0)
+                    {
+                        isr = sgHomeISR;
+                    }
+                }
+            }
+            sgStepLevel = value;
+        }
+    }
+
+    sgStepCondition.notify_all();
+
+    if (isr)
+        isr();
+}
+
+int digitalRead(int pin)
+{
+    std::lock_guard<std::mutex> lock(sgLock);
+
+    if (pin == PIN_nHOME)
+        return sgIndexerState == 0 ? 0 : 1;
+
+    // Never report a fault
+    if (pin == PIN_nFAULT)
+        return 1;
+
+    return 0;
+}
+
+void delayMicroseconds(unsigned int howLong)
+{
+    // Busy loop as wiringPi does for short delays
+    const int64_t until = GPIORecorder::NowMicroseconds() + howLong;
+    while (GPIORecorder::NowMicroseconds() < until)
+        ;
+}
+
+int wiringPiISR(int pin, int mode, void (*function)(void))
+{
+    (void)mode;
+
+    std::lock_guard<std::mutex> lock(sgLock);
+
+    if (pin == PIN_nHOME)
+        sgHomeISR = function;
+
+    // nFAULT never changes so its ISR is never raised.
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Recorder Queries
+//////////////////////////////////////////////////////////////////////
+
+int64_t GPIORecorder::NowMicroseconds()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::vector<GPIORecorder::StepEdge> GPIORecorder::StepsSince(int64_t timeUs)
+{
+    std::lock_guard<std::mutex> lock(sgLock);
+
+    std::vector<StepEdge> steps;
+    for (auto it = sgSteps.rbegin(); it != sgSteps.rend() && it->timeUs >= timeUs; ++it)
+        steps.insert(steps.begin(), *it);
+
+    return steps;
+}
+
+bool GPIORecorder::WaitForIdle(std::chrono::milliseconds quiet, std::chrono::milliseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    std::unique_lock<std::mutex> lock(sgLock);
+
+    size_t stepCount = sgSteps.size();
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        // Any step wakes the wait early, restart the quiet period.
+        if (!sgStepCondition.wait_for(lock, quiet, [&]() { return sgSteps.size() != stepCount; }))
+            return true;
+
+        stepCount = sgSteps.size();
+    }
+
+    return false;
+}
+
+bool GPIORecorder::WaitForStepSince(int64_t timeUs, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(sgLock);
+
+    return sgStepCondition.wait_for(lock, timeout, [&]() {
+            return !sgSteps.empty() && sgSteps.back().timeUs >= timeUs;
+        });
+}
+
+int64_t GPIORecorder::IndexerSteps()
+{
+    std::lock_guard<std::mutex> lock(sgLock);
+
+    return sgIndexerSteps;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Fault Injection
+//////////////////////////////////////////////////////////////////////
+
+void GPIORecorder::DropSteps(size_t count, size_t after)
+{
+    std::lock_guard<std::mutex> lock(sgLock);
+
+    sgDropCount = count;
+    sgDropAfter = after;
+}
+
+size_t GPIORecorder::PendingDrops()
+{
+    std::lock_guard<std::mutex> lock(sgLock);
+
+    return sgDropCount;
+}
+
+void GPIORecorder::SetHomeISRDelay(std::chrono::microseconds delay)
+{
+    std::thread finished;
+
+    {
+        std::lock_guard<std::mutex> lock(sgLock);
+
+        sgHomeISRDelay = delay;
+
+        if (delay.count() > 0 && !sgDeferredThread.joinable())
+        {
+            sgStopDeferredThread = false;
+            sgDeferredThread = std::thread(_DispatchDeferredHomeISRs);
+        }
+        else if (delay.count() <= 0 && sgDeferredThread.joinable())
+        {
+            sgStopDeferredThread = true;
+            finished = std::move(sgDeferredThread);
+        }
+    }
+
+    sgDeferredCondition.notify_one();
+
+    if (finished.joinable())
+        finished.join();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Stand-in for the wiringPi GPIO backend. Records STEP edges with their
+// timestamp and emulates the DRV8805 indexer so nHOME interrupts fire as
+// they would on the real hardware. Faults may be injected to exercise the
+// driver's step verification.
+class GPIORecorder {
+
+public:
+    struct StepEdge {
+        int64_t timeUs;
+        bool clockwise;
+    };
+
+public:
+    static int64_t NowMicroseconds();
+
+    // All STEP rising edges recorded at or after timeUs.
+    static std::vector<StepEdge> StepsSince(int64_t timeUs);
+
+    // Block until no STEP edge has been seen for the quiet period.
+    // Returns false if the timeout expired first.
+    static bool WaitForIdle(std::chrono::milliseconds quiet, std::chrono::milliseconds timeout);
+
+    // Block until a STEP edge at or after timeUs has been recorded.
+    static bool WaitForStepSince(int64_t timeUs, std::chrono::milliseconds timeout);
+
+    // Net STEP pulses registered by the emulated indexer, clockwise positive.
+    static int64_t IndexerSteps();
+
+public:
+    // The indexer ignores count STEP pulses once after further pulses have
+    // been registered. Ignored pulses are still recorded as edges.
+    static void DropSteps(size_t count, size_t after = 0);
+    // Requested drops yet to occur.
+    static size_t PendingDrops();
+
+    // Invoke nHOME ISRs this long after the edge, as a busy wiringPi ISR
+    // thread would. The nHOME level still changes immediately. Zero restores
+    // synchronous ISRs once those outstanding have been invoked.
+    static void SetHomeISRDelay(std::chrono::microseconds delay);
+};
@@ -0,0 +1,572 @@
+/*
+    Command to STEP pulse latency benchmark for the MUP Astro CAT driver.
+
+    Copyright © 2016 Gary Preston (gary@mups.co.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Usage:
+        indi_mupastrocat_latency [--iterations N] [--speed STEPS_PER_SEC] [--output FILE]
+        indi_mupastrocat_latency --check-steps [--speed STEPS_PER_SEC] [--output FILE]
+
+    Drives the driver in-process via the ISNewNumber/ISNewSwitch entry points
+    with GPIO writes captured by GPIORecorder. Each scenario is repeated N
+    times and a JSON report written to FILE (default stdout) suitable for
+    diffing between driver builds.
+
+    Scenarios:
+        - single_move: ABS_FOCUS_POSITION set whilst idle, measures time to
+          the first STEP edge and achieved step rate.
+        - retarget: a burst of back to back ABS_FOCUS_POSITION reversals mid
+          move, each issued as soon as the previous one produced a STEP edge
+          in its new direction. Measures time to that first STEP edge.
+        - abort: FOCUS_ABORT_MOTION mid move, counts STEP edges issued after
+          the abort and measures the offset of the last STEP edge from the
+          abort, negative when motion stopped before another step. Those
+          aborts are also counted in stopped_before_next_step.
+
+    --check-steps instead injects indexer faults via GPIORecorder and checks
+    the driver's nHOME step verification handles them, exiting non-zero on
+    any failure:
+        - late_home_isr: nHOME ISRs delivered several step periods late, no
+          missed step may be reported.
+        - dropped_step: a single STEP pulse ignored by the indexer, it must be
+          re-issued leaving the indexer in sync without an alert.
+        - dropped_step_late_home_isr: both of the above.
+        - dropped_step_pair: two consecutive pulses ignored, which cannot be
+          recovered, so the Missed Step alert must be raised.
+    Each is run with the fault at every indexer state in the final home cycle
+    of a move.
+
+    Telemetry publishing is disabled so the benchmark can safely run alongside
+    a connected driver.
+
+    --speed must be accepted by the driver, the report records the
+    FOCUS_SPEED value the driver is actually using. Timeouts allow for the
+    steps expected at that speed.
+
+    Statistics are null for empty sample sets. The exit status is non-zero
+    if any scenario recorded only failures.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "libindi/indidevapi.h"
+
+#include "mupastrocat.h"
+#include "gpiorecorder.h"
+
+extern std::unique_ptr<MUPAstroCAT> sgMupAstroCAT;
+
+//////////////////////////////////////////////////////////////////////
+// Constants
+//////////////////////////////////////////////////////////////////////
+
+const char* DEVICE_NAME = "MUP Astro CAT";
+const int REPORT_VERSION = 1;
+
+const uint32_t HOME_POSITION = 0;
+const uint32_t SINGLE_MOVE_STEPS = 100;
+const uint32_t LONG_MOVE_STEPS = 400;
+const size_t INTERRUPT_AFTER_STEPS = 20;
+const int RETARGET_BURST = 5;
+
+// Must match the indexer cycle emulated by GPIORecorder.
+const size_t STEPS_PER_HOME_CYCLE = 4;
+// Each home edge is then handled whilst verifying the following home step,
+// which is only correct if the late edge is attributed to the earlier one.
+const double LATE_HOME_ISR_STEP_PERIODS = 4.5;
+
+// Allowed on top of the time the expected steps take at the benchmark speed.
+const std::chrono::milliseconds COMMAND_TIMEOUT {5000};
+
+//////////////////////////////////////////////////////////////////////
+// Statistics
+//////////////////////////////////////////////////////////////////////
+
+struct Samples {
+    std::vector<double> values;
+    size_t failures = 0;
+};
+
+// Nearest rank percentile of sorted values.
+static double Percentile(const std::vector<double> &sorted, double pct)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    size_t rank = static_cast<size_t>(pct / 100.0 * sorted.size() + 0.5);
+    rank = std::min(std::max(rank, static_cast<size_t>(1)), sorted.size());
+
+    return sorted[rank - 1];
+}
+
+static void WriteSamples(FILE *fp, const char *name, const Samples &samples, bool last)
+{
+    std::vector<double> sorted = samples.values;
+    std::sort(sorted.begin(), sorted.end());
+
+    double mean = 0.0;
+    for (double v : sorted)
+        mean += v;
+    if (!sorted.empty())
+        mean /= sorted.size();
+
+    fprintf(fp, "      \"%s\": { \"count\": %zu, \"failures\": %zu, ", name, sorted.size(), samples.failures);
+
+    // Nothing measured, avoid reporting what looks like a zero latency.
+    if (sorted.empty())
+        fprintf(fp, "\"min\": null, \"p50\": null, \"p90\": null, \"p99\": null, \"max\": null, \"mean\": null }%s\n",
+                last ? "" : ",");
+    else
+        fprintf(fp, "\"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f, \"mean\": %.1f }%s\n",
+                sorted.front(), Percentile(sorted, 50), Percentile(sorted, 90), Percentile(sorted, 99),
+                sorted.back(), mean, last ? "" : ",");
+}
+
+// True if every run of a scenario failed.
+static bool OnlyFailures(const Samples &samples)
+{
+    return samples.values.empty() && samples.failures > 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Driver Commands
+//////////////////////////////////////////////////////////////////////
+
+static void Connect()
+{
+    ISState states[] = { ISS_ON, ISS_OFF };
+    char connect[] = "CONNECT";
+    char disconnect[] = "DISCONNECT";
+    char *names[] = { connect, disconnect };
+
+    ISGetProperties(nullptr);
+    ISNewSwitch(DEVICE_NAME, "CONNECTION", states, names, 2);
+}
+
+static void Disconnect()
+{
+    ISState states[] = { ISS_OFF, ISS_ON };
+    char connect[] = "CONNECT";
+    char disconnect[] = "DISCONNECT";
+    char *names[] = { connect, disconnect };
+
+    ISNewSwitch(DEVICE_NAME, "CONNECTION", states, names, 2);
+}
+
+static void SetSpeed(double speed)
+{
+    char name[] = "FOCUS_SPEED_VALUE";
+    char *names[] = { name };
+
+    ISNewNumber(DEVICE_NAME, "FOCUS_SPEED", &speed, names, 1);
+}
+
+static double GetSpeed()
+{
+    INumberVectorProperty *speed = sgMupAstroCAT->getNumber("FOCUS_SPEED");
+    return speed ? speed->np[0].value : 0.0;
+}
+
+static void SetAbsPosition(uint32_t position)
+{
+    double value = position;
+    char name[] = "FOCUS_ABSOLUTE_POSITION";
+    char *names[] = { name };
+
+    ISNewNumber(DEVICE_NAME, "ABS_FOCUS_POSITION", &value, names, 1);
+}
+
+static bool IsMissedStepAlert()
+{
+    ILightVectorProperty *status = sgMupAstroCAT->getLight("FOCUSER_STATUS");
+    return status && status->lp[1].s == IPS_ALERT;
+}
+
+static void Abort()
+{
+    ISState state = ISS_ON;
+    char name[] = "ABORT";
+    char *names[] = { name };
+
+    ISNewSwitch(DEVICE_NAME, "FOCUS_ABORT_MOTION", &state, names, 1);
+}
+
+// Time allowed for a command expected to take the given number of steps.
+static std::chrono::milliseconds StepTimeout(size_t steps, double speed)
+{
+    return COMMAND_TIMEOUT + std::chrono::milliseconds(static_cast<int64_t>(steps * 1000 / speed));
+}
+
+// Abort a move that timed out so it cannot overlap the next command.
+static void StopMove(std::chrono::milliseconds quiet)
+{
+    Abort();
+    GPIORecorder::WaitForIdle(quiet, COMMAND_TIMEOUT);
+}
+
+// Wait until n steps have occurred since the given time.
+static bool WaitForSteps(int64_t sinceUs, size_t n, std::chrono::milliseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (GPIORecorder::StepsSince(sinceUs).size() < n)
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+// Wait until a step in the given direction has occurred since the given time.
+static const GPIORecorder::StepEdge* WaitForDirection(int64_t sinceUs, bool clockwise, std::vector<GPIORecorder::StepEdge> &steps,
+                                                      std::chrono::milliseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    do
+    {
+        steps = GPIORecorder::StepsSince(sinceUs);
+
+        auto step = std::find_if(steps.begin(), steps.end(), [&](const GPIORecorder::StepEdge &s) { return s.clockwise == clockwise; });
+        if (step != steps.end())
+            return &*step;
+
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    while (std::chrono::steady_clock::now() < deadline);
+
+    return nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Step Verification Checks
+//////////////////////////////////////////////////////////////////////
+
+struct StepCheck {
+    const char *name;
+    size_t drops;           // consecutive STEP pulses ignored by the indexer
+    bool lateHomeISR;
+    bool expectMissedStep;  // otherwise the indexer must end in sync
+};
+
+const StepCheck STEP_CHECKS[] = {
+    { "late_home_isr",              0, true,  false },
+    { "dropped_step",               1, false, false },
+    { "dropped_step_late_home_isr", 1, true,  false },
+    { "dropped_step_pair",          2, false, true  },
+};
+
+// Run each check with the fault injected at every indexer state, writing the
+// results to the report. Returns false if any run failed.
+static bool CheckStepVerification(FILE *report, double speed, std::chrono::milliseconds quiet)
+{
+    const std::chrono::microseconds lateDelay(static_cast<int64_t>(LATE_HOME_ISR_STEP_PERIODS * 1e6 / speed));
+    bool passed = true;
+
+    fprintf(report, "  \"checks\": {\n");
+
+    for (size_t c = 0; c < sizeof(STEP_CHECKS) / sizeof(STEP_CHECKS[0]); ++c)
+    {
+        const StepCheck &check = STEP_CHECKS[c];
+        size_t failures = 0;
+
+        for (size_t phase = 0; phase < STEPS_PER_HOME_CYCLE; ++phase)
+        {
+            if (check.lateHomeISR)
+                GPIORecorder::SetHomeISRDelay(lateDelay);
+            // Fault ends phase steps before the move completes. Drops not corrected
+            // within the same home cycle then leave the indexer out of sync.
+            const size_t dropAfter = SINGLE_MOVE_STEPS - check.drops - phase;
+            GPIORecorder::DropSteps(check.drops, dropAfter);
+
+            const int64_t indexerStart = GPIORecorder::IndexerSteps();
+            const int64_t start = GPIORecorder::NowMicroseconds();
+            SetAbsPosition(HOME_POSITION + SINGLE_MOVE_STEPS);
+
+            const bool moved = GPIORecorder::WaitForStepSince(start, StepTimeout(1, speed)) &&
+                               GPIORecorder::WaitForIdle(quiet, StepTimeout(SINGLE_MOVE_STEPS, speed));
+
+            // Outward moves step the motor anti-clockwise.
+            const int64_t indexerSteps = indexerStart - GPIORecorder::IndexerSteps();
+            const bool missedStep = IsMissedStepAlert();
+            const size_t pendingDrops = GPIORecorder::PendingDrops();
+
+            GPIORecorder::SetHomeISRDelay(std::chrono::microseconds(0));
+            GPIORecorder::DropSteps(0);
+
+            if (!moved || pendingDrops > 0 || missedStep != check.expectMissedStep ||
+                (!check.expectMissedStep && indexerSteps != SINGLE_MOVE_STEPS))
+            {
+                fprintf(stderr, "%s failed with fault after %zu steps: moved %d, missed step %d, indexer registered %lld of %u steps.\n",
+                        check.name, dropAfter, moved, missedStep, static_cast<long long>(indexerSteps), SINGLE_MOVE_STEPS);
+                failures++;
+            }
+
+            if (!moved)
+                StopMove(quiet);
+
+            SetAbsPosition(HOME_POSITION);
+            GPIORecorder::WaitForIdle(quiet, StepTimeout(SINGLE_MOVE_STEPS, speed));
+
+            // Reconnect to reset the indexer and restore any speed backoff.
+            Disconnect();
+            Connect();
+            SetSpeed(speed);
+        }
+
+        fprintf(report, "    \"%s\": { \"runs\": %zu, \"failures\": %zu }%s\n",
+                check.name, STEPS_PER_HOME_CYCLE, failures, c + 1 < sizeof(STEP_CHECKS) / sizeof(STEP_CHECKS[0]) ? "," : "");
+
+        passed = passed && failures == 0;
+    }
+
+    fprintf(report, "  }\n");
+
+    return passed;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Benchmark
+//////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+    int iterations = 20;
+    double speed = 250;
+    std::string output = "-";
+    bool checkSteps = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+            iterations = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+        {
+            char *end = nullptr;
+            speed = strtod(argv[++i], &end);
+            if (*end != '\0' || !(speed > 0))
+            {
+                fprintf(stderr, "Invalid --speed %s, expected a positive number of steps per second.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (strcmp(argv[i], "--check-steps") == 0)
+            checkSteps = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [--iterations N] [--speed STEPS_PER_SEC] [--output FILE]\n", argv[0]);
+            fprintf(stderr, "       %s --check-steps [--speed STEPS_PER_SEC] [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Driver writes INDI XML to stdout, keep it out of the report.
+    FILE *report = output == "-" ? fdopen(dup(fileno(stdout)), "w") : fopen(output.c_str(), "w");
+    if (!report || !freopen("/dev/null", "w", stdout))
+    {
+        fprintf(stderr, "Unable to open report output %s\n", output.c_str());
+        return 1;
+    }
+
+    // Never publish telemetry, a driver may be running on this machine.
+    setenv(TELEMETRY_SEGMENT_ENV, "", 1);
+
+    Connect();
+    SetSpeed(speed);
+
+    // Driver silently ignores out of range speeds, only report what is in use.
+    const double requestedSpeed = speed;
+    speed = GetSpeed();
+    if (speed != requestedSpeed)
+    {
+        fprintf(stderr, "Driver rejected --speed %g, FOCUS_SPEED is %g.\n", requestedSpeed, speed);
+        Disconnect();
+        return 1;
+    }
+
+    // Long enough that a gap between steps is never mistaken for idle.
+    const std::chrono::milliseconds quiet(std::max<long>(50, static_cast<long>(5000 / speed)));
+
+    if (checkSteps)
+    {
+        fprintf(report, "{\n");
+        fprintf(report, "  \"benchmark\": \"indi_mupastrocat_step_checks\",\n");
+        fprintf(report, "  \"version\": %d,\n", REPORT_VERSION);
+        fprintf(report, "  \"speed_steps_per_second\": %g,\n", speed);
+
+        const bool passed = CheckStepVerification(report, speed, quiet);
+
+        fprintf(report, "}\n");
+        fclose(report);
+
+        Disconnect();
+
+        return passed ? 0 : 1;
+    }
+
+    Samples moveLatency, moveRate, retargetLatency, abortSteps, abortLastStepOffset;
+    size_t abortStoppedBeforeStep = 0;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        // Single move out and back in again.
+        for (uint32_t target : { HOME_POSITION + SINGLE_MOVE_STEPS, HOME_POSITION })
+        {
+            const int64_t start = GPIORecorder::NowMicroseconds();
+            SetAbsPosition(target);
+
+            if (!GPIORecorder::WaitForStepSince(start, StepTimeout(1, speed)) ||
+                !GPIORecorder::WaitForIdle(quiet, StepTimeout(SINGLE_MOVE_STEPS, speed)))
+            {
+                moveLatency.failures++;
+                StopMove(quiet);
+                continue;
+            }
+
+            auto steps = GPIORecorder::StepsSince(start);
+            moveLatency.values.push_back(steps.front().timeUs - start);
+
+            if (steps.size() > 1)
+                moveRate.values.push_back((steps.size() - 1) * 1e6 / (steps.back().timeUs - steps.front().timeUs));
+        }
+
+        // Burst of back to back reversals part way through an outward move.
+        {
+            const int64_t moveStart = GPIORecorder::NowMicroseconds();
+            SetAbsPosition(HOME_POSITION + LONG_MOVE_STEPS);
+
+            if (!WaitForSteps(moveStart, INTERRUPT_AFTER_STEPS, StepTimeout(INTERRUPT_AFTER_STEPS, speed)))
+            {
+                retargetLatency.failures += RETARGET_BURST;
+                StopMove(quiet);
+            }
+            else
+            {
+                for (int r = 0; r < RETARGET_BURST; ++r)
+                {
+                    // Inward moves step the motor clockwise.
+                    const bool inward = r % 2 == 0;
+
+                    const int64_t start = GPIORecorder::NowMicroseconds();
+                    SetAbsPosition(inward ? HOME_POSITION : HOME_POSITION + LONG_MOVE_STEPS);
+
+                    std::vector<GPIORecorder::StepEdge> steps;
+                    const GPIORecorder::StepEdge *first = WaitForDirection(start, inward, steps, StepTimeout(1, speed));
+                    if (!first)
+                    {
+                        retargetLatency.failures++;
+                        StopMove(quiet);
+                        break;
+                    }
+
+                    retargetLatency.values.push_back(first->timeUs - start);
+                }
+            }
+
+            SetAbsPosition(HOME_POSITION);
+            GPIORecorder::WaitForIdle(quiet, StepTimeout(LONG_MOVE_STEPS, speed));
+        }
+
+        // Abort part way through an outward move then return home.
+        {
+            const int64_t moveStart = GPIORecorder::NowMicroseconds();
+            SetAbsPosition(HOME_POSITION + LONG_MOVE_STEPS);
+
+            if (!WaitForSteps(moveStart, INTERRUPT_AFTER_STEPS, StepTimeout(INTERRUPT_AFTER_STEPS, speed)))
+            {
+                abortSteps.failures++;
+                StopMove(quiet);
+            }
+            else
+            {
+                const int64_t start = GPIORecorder::NowMicroseconds();
+                Abort();
+                GPIORecorder::WaitForIdle(quiet, StepTimeout(1, speed));
+
+                auto steps = GPIORecorder::StepsSince(start);
+                abortSteps.values.push_back(steps.size());
+
+                if (steps.empty())
+                    abortStoppedBeforeStep++;
+
+                // The move had already stepped so there is always a last edge.
+                abortLastStepOffset.values.push_back(GPIORecorder::StepsSince(moveStart).back().timeUs - start);
+            }
+
+            SetAbsPosition(HOME_POSITION);
+            GPIORecorder::WaitForIdle(quiet, StepTimeout(LONG_MOVE_STEPS, speed));
+        }
+    }
+
+    Disconnect();
+
+    fprintf(report, "{\n");
+    fprintf(report, "  \"benchmark\": \"indi_mupastrocat_latency\",\n");
+    fprintf(report, "  \"version\": %d,\n", REPORT_VERSION);
+    fprintf(report, "  \"iterations\": %d,\n", iterations);
+    fprintf(report, "  \"speed_steps_per_second\": %g,\n", speed);
+    fprintf(report, "  \"scenarios\": {\n");
+    fprintf(report, "    \"single_move\": {\n");
+    WriteSamples(report, "command_to_first_step_us", moveLatency, false);
+    WriteSamples(report, "steps_per_second", moveRate, true);
+    fprintf(report, "    },\n");
+    fprintf(report, "    \"retarget\": {\n");
+    fprintf(report, "      \"burst\": %d,\n", RETARGET_BURST);
+    WriteSamples(report, "command_to_first_step_us", retargetLatency, true);
+    fprintf(report, "    },\n");
+    fprintf(report, "    \"abort\": {\n");
+    fprintf(report, "      \"stopped_before_next_step\": %zu,\n", abortStoppedBeforeStep);
+    WriteSamples(report, "steps_after_abort", abortSteps, false);
+    WriteSamples(report, "last_step_offset_us", abortLastStepOffset, true);
+    fprintf(report, "    }\n");
+    fprintf(report, "  }\n");
+    fprintf(report, "}\n");
+
+    fclose(report);
+
+    const std::pair<const char*, const Samples*> scenarios[] = {
+        { "single_move", &moveLatency },
+        { "retarget", &retargetLatency },
+        { "abort", &abortSteps },
+    };
+
+    bool failed = false;
+    for (const auto &scenario : scenarios)
+    {
+        if (OnlyFailures(*scenario.second))
+        {
+            fprintf(stderr, "Every %s run failed.\n", scenario.first);
+            failed = true;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
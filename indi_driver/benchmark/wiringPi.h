@@ -0,0 +1,28 @@
+#pragma once
+
+// Declarations for the subset of the wiringPi API used by the driver. Allows
+// the benchmark to build without wiringPi installed, the definitions are
+// provided by gpiorecorder.cpp. Values match wiringPi.h.
+
+#define INPUT  0
+#define OUTPUT 1
+
+#define INT_EDGE_SETUP   0
+#define INT_EDGE_FALLING 1
+#define INT_EDGE_RISING  2
+#define INT_EDGE_BOTH    3
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  wiringPiSetupGpio(void);
+extern void pinMode(int pin, int mode);
+extern void digitalWrite(int pin, int value);
+extern int  digitalRead(int pin);
+extern void delayMicroseconds(unsigned int howLong);
+extern int  wiringPiISR(int pin, int mode, void (*function)(void));
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+/*
+    Example reader for the MUP Astro CAT shared memory telemetry.
+
+    Copyright © 2016 Gary Preston (gary@mups.co.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Usage:
+        mupastrocat_telemetry_reader [interval_ms] [segment_name]
+
+    Prints a telemetry snapshot every interval (default 1000ms) whilst the
+    driver is connected. Exits once the driver disconnects or stops updating
+    the segment (e.g. it crashed).
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "telemetry.h"
+
+int main(int argc, char *argv[])
+{
+    const int intervalMs = argc > 1 ? std::max(1, atoi(argv[1])) : 1000;
+    const char *segmentName = argc > 2 ? argv[2] : TELEMETRY_SEGMENT_NAME;
+
+    const TelemetrySegment *segment = OpenTelemetry(segmentName);
+    if (!segment)
+    {
+        fprintf(stderr, "Telemetry segment %s unavailable, is the driver connected?\n", segmentName);
+        return 1;
+    }
+
+    for (;;)
+    {
+        Telemetry snapshot;
+        if (!ReadTelemetry(segment, snapshot))
+        {
+            fprintf(stderr, "Unable to read a consistent snapshot.\n");
+        }
+        else
+        {
+            printf("%" PRId64 " position: %" PRIu32 " target: %" PRIu32 " speed: %g%s%s%s\n",
+                   snapshot.monotonicTimeUs, snapshot.currentPosition, snapshot.targetPosition, snapshot.speed,
+                   snapshot.flags & TELEMETRY_MOVING ? " MOVING" : "",
+                   snapshot.flags & TELEMETRY_FAULT ? " FAULT" : "",
+                   snapshot.flags & TELEMETRY_MISSED_STEP ? " MISSED_STEP" : "");
+
+            if (!IsTelemetryLive(snapshot))
+            {
+                printf(snapshot.flags & TELEMETRY_CONNECTED ? "Driver stopped updating telemetry.\n" : "Driver disconnected.\n");
+                break;
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+
+    CloseTelemetry(segment);
+
+    return 0;
+}
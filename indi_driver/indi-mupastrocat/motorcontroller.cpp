@@ -21,7 +21,7 @@
         - Expects wiringPiSetupGpio to have already been setup.
 
     TODO:
-        - Expose Full/Half/Wave step modes.
+        - Expose Full/Half/Wave step modes (STEPS_PER_HOME_CYCLE must follow SM0/SM1).
         - Support configuration of control pins.
         - Account for backlash during direction change.
 
@@ -33,8 +33,17 @@
         - NOTE: In half and wave modes, after an initial reset it appears to take two STEP calls
                 to move out of the home position on the first cycle but only one step call for
                 subsequent cycles.
+        - nHOME is asserted (low) whilst the indexer is in its home state which
+          occurs once every 4 steps in full step mode. Dropped STEP pulses are
+          detected by comparing nHOME falling edges against the predicted indexer
+          state. wiringPi ISRs run on a thread woken via poll() so edges may be
+          handled several steps late, any disagreement is settled by reading the
+          nHOME level directly before acting on it.
+        - The indexer advances on every registered STEP whether or not the rotor
+          follows, nHOME cannot detect a stalled or slipping motor.
 */
 
+#include <algorithm>
 #include <chrono>
 
 #include <wiringPi.h>
@@ -51,6 +60,9 @@
 const std::chrono::microseconds MIN_STEP_PULSE_HOLD {2};
 const std::chrono::microseconds MIN_SETUP_DELAY {1};
 
+// Indexer steps between home states for full step mode (SM0=0, SM1=0).
+const int STEPS_PER_HOME_CYCLE = 4;
+
 // TODO: Controller should be initialised with the GPIO pins rather than hardcoded below
 // Pi BCM Input Pin numbers
 const int OUTPUT_PIN_nENABLE = 21;
@@ -68,6 +80,7 @@ const int INPUT_PIN_nFAULT = 6;
 //////////////////////////////////////////////////////////////////////
 
 std::function<void(void)> MotorController::sFaultChangeCallback;
+std::atomic<uint32_t> MotorController::sHomeEdgeCount{ 0 };
 
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
@@ -99,6 +112,14 @@ MotorController::~MotorController()
 
 void MotorController::Enable()
 {
+    // wiringPi provides no way to remove an ISR, only register once.
+    static bool homeISRRegistered = false;
+    if (!homeISRRegistered)
+    {
+        wiringPiISR( INPUT_PIN_nHOME, INT_EDGE_FALLING, &MotorController::_OnHomeEdge );
+        homeISRRegistered = true;
+    }
+
     digitalWrite(OUTPUT_PIN_nENABLE, 0);
 
     digitalWrite(OUTPUT_PIN_RESET, 1);
@@ -109,6 +130,13 @@ void MotorController::Enable()
     digitalWrite(OUTPUT_PIN_SM0, 0);
     digitalWrite(OUTPUT_PIN_SM1, 0);
 
+    // Reset returns the indexer to home. An edge caused by the reset itself may be
+    // handled after this point, VerifyStepIndex treats it as stale via the nHOME level.
+    mIndexerState = 0;
+    mStepPending = false;
+    mLastHomeEdgeCount = sHomeEdgeCount;
+    mLateHomeEdges = 0;
+
     SetFocusDirection(FocusDirection::ANTI_CLOCKWISE);
 }
 
@@ -121,10 +149,10 @@ void MotorController::Disable()
 
 void MotorController::StepMotor()
 {
-    // delayMicroseconds should busyloop for <= 100uS            
-    digitalWrite(OUTPUT_PIN_STEP, 1);
-    delayMicroseconds(MIN_STEP_PULSE_HOLD.count());
-    digitalWrite(OUTPUT_PIN_STEP, 0);
+    _PulseStep();
+
+    mIndexerState = (mIndexerState + mIndexerDirection + STEPS_PER_HOME_CYCLE) % STEPS_PER_HOME_CYCLE;
+    mStepPending = true;
 }
 
 bool MotorController::hasFault() const
@@ -132,6 +160,61 @@ bool MotorController::hasFault() const
     return digitalRead(INPUT_PIN_nFAULT) == 0;
 }
 
+MotorController::StepVerification MotorController::VerifyStepIndex()
+{
+    if (!mStepPending)
+        return StepVerification::OK;
+
+    mStepPending = false;
+
+    const uint32_t edgeCount = sHomeEdgeCount;
+    uint32_t newEdges = edgeCount - mLastHomeEdgeCount;
+    mLastHomeEdgeCount = edgeCount;
+
+    // Edges for earlier arrivals that were handled late.
+    const uint32_t lateEdges = std::min(newEdges, mLateHomeEdges);
+    mLateHomeEdges -= lateEdges;
+    newEdges -= lateEdges;
+
+    const bool predictHome = mIndexerState == 0;
+
+    if (newEdges == (predictHome ? 1u : 0u))
+        return StepVerification::OK;
+
+    // Edges disagree, either the ISR is lagging or a pulse was dropped. The level is authoritative.
+    if (_IsIndexerHome() == predictHome)
+    {
+        if (predictHome && newEdges == 0)
+            mLateHomeEdges++;
+
+        return StepVerification::OK;
+    }
+
+    // Indexer one state behind the prediction, re-issue the dropped pulse.
+    const int previousState = (mIndexerState - mIndexerDirection + STEPS_PER_HOME_CYCLE) % STEPS_PER_HOME_CYCLE;
+    if (predictHome || previousState == 0)
+    {
+        _PulseStep();
+
+        if (_IsIndexerHome() == predictHome)
+        {
+            if (predictHome)
+                mLateHomeEdges++;
+
+            return StepVerification::CORRECTED;
+        }
+    }
+
+    // Unable to determine how far the indexer is out, resync when known.
+    if (_IsIndexerHome())
+        mIndexerState = 0;
+
+    mLateHomeEdges = 0;
+    mLastHomeEdgeCount = sHomeEdgeCount;
+
+    return StepVerification::FAILED;
+}
+
 //////////////////////////////////////////////////////////////////////
 // Focuser Private
 //////////////////////////////////////////////////////////////////////
@@ -142,9 +225,32 @@ void MotorController::SetFocusDirection(FocusDirection dir)
     //       and if direction change requested account for backlash by stepping X times.
 
     digitalWrite(OUTPUT_PIN_DIR, dir == FocusDirection::CLOCKWISE ? 1 : 0);
+    mIndexerDirection = dir == FocusDirection::CLOCKWISE ? 1 : -1;
     delayMicroseconds(MIN_SETUP_DELAY.count());
 }
 
+void MotorController::_PulseStep()
+{
+    // delayMicroseconds should busyloop for <= 100uS            
+    digitalWrite(OUTPUT_PIN_STEP, 1);
+    delayMicroseconds(MIN_STEP_PULSE_HOLD.count());
+    digitalWrite(OUTPUT_PIN_STEP, 0);
+}
+
+bool MotorController::_IsIndexerHome() const
+{
+    return digitalRead(INPUT_PIN_nHOME) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Interrupt Handlers
+//////////////////////////////////////////////////////////////////////
+
+void MotorController::_OnHomeEdge()
+{
+    sHomeEdgeCount++;
+}
+
 //////////////////////////////////////////////////////////////////////
 // Class Statics 
 //////////////////////////////////////////////////////////////////////
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
 
 // Interface with DRV8805 via GPIO pins.
@@ -7,6 +8,9 @@ class MotorController {
 
 public:
     enum class FocusDirection { CLOCKWISE, ANTI_CLOCKWISE };
+    // CORRECTED: a dropped STEP pulse was re-issued, indexer is back in sync.
+    // FAILED: indexer state could not be recovered, position is unknown.
+    enum class StepVerification { OK, CORRECTED, FAILED };
 
 public:
     MotorController();
@@ -21,12 +25,35 @@ public:
 
     bool hasFault() const;
 
+    // Check the indexer reached the state predicted from the step count.
+    // Should be called after each StepMotor once the step period has elapsed.
+    // NOTE: nHOME follows the DRV8805 indexer, not the rotor. This detects STEP
+    //       pulses the controller did not register, not a stalled motor.
+    StepVerification VerifyStepIndex();
+
     // Set a callback notification handler for fault status change.
     // NOTE: Until wiringpi provides a user_context* there is currently no
     //       way for callback receiver to know which instance of 
     //       MotorController raised the callback outside of querying each.
     static void SetFaultChangeCallback( std::function<void(void)> callback );
 
+private:
+    void _PulseStep();
+    bool _IsIndexerHome() const;
+
+    static void _OnHomeEdge();
+
 private:
     static std::function<void(void)> sFaultChangeCallback;
+
+    // Updated from nHOME ISR.
+    static std::atomic<uint32_t> sHomeEdgeCount;
+
+    // Predicted DRV8805 indexer state, 0 being home.
+    int mIndexerState = 0;
+    int mIndexerDirection = 1;
+    bool mStepPending = false;
+    uint32_t mLastHomeEdgeCount = 0;
+    // Home arrivals confirmed via the nHOME level whose edge the ISR has yet to handle.
+    uint32_t mLateHomeEdges = 0;
 };
\ No newline at end of file
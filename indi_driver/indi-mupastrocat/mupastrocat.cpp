@@ -21,6 +21,7 @@
         - Temperature display/compensation/calibration    
         - separate out the focuser thread and related properties
         - OPTIONS_TAB for backlash and reset/zero button.        
+        - Populate telemetry temperature once supported.
     Extra Notes:
         - Expects user to move drawtube fully in and "reset" to reach initial zero state
         - See: http://focuser.com/focusmax.php
@@ -29,8 +30,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cinttypes>
 #include <cmath>
+#include <cstdlib>
 #include <memory>
 #include <thread>
 #include <cstring>
@@ -47,6 +50,12 @@ const char* DEFAULT_DEVICE_NAME = "MUP Astro CAT";
 const double DEFAULT_MIN_POSITION = 0.0;
 const double DEFAULT_MAX_POSITION = 7000.0;
 
+// Speed reduction applied on each unrecoverable missed step when auto backoff is enabled.
+const double MISSED_STEP_SPEED_BACKOFF = 0.8;
+
+// Focus thread wakes at least this often to refresh idle telemetry.
+const std::chrono::microseconds TELEMETRY_IDLE_PERIOD {TELEMETRY_HEARTBEAT_US};
+
 //////////////////////////////////////////////////////////////////////
 // Driver Instance
 //////////////////////////////////////////////////////////////////////
@@ -128,6 +137,20 @@ bool MUPAstroCAT::Connect()
 
     IDMessage(getDeviceName(), "Connected to device.");
 
+    // Segment name may be overridden, or publishing disabled with an empty name.
+    const char *segmentName = getenv(TELEMETRY_SEGMENT_ENV);
+    if (!segmentName)
+        segmentName = TELEMETRY_SEGMENT_NAME;
+
+    if (*segmentName && !mTelemetryPublisher.Open(segmentName))
+        IDMessage(getDeviceName(), "Unable to create telemetry segment %s: %s", segmentName, strerror(errno));
+
+    // Readers may attach before the first idle heartbeat, publish the initial state now.
+    {
+        std::lock_guard<std::mutex> lock(mFocusLock);
+        _PublishTelemetry(false);
+    }
+
     // Start focus thread
     mStopFocusThread = false;
     mFocusThread = std::thread(&MUPAstroCAT::_ContinualFocusToTarget,this);
@@ -165,8 +188,14 @@ bool MUPAstroCAT::initProperties()
 
     // TODO: Extra properties for backlash, current temp, temp compensation etc
 
-    IUFillLight(&mFaultLight, "FOCUSER_FAULT_VALUE", "Motor Fault", IPS_IDLE);
-    IUFillLightVector(&mStatusLightProperty, &mFaultLight, 1, getDeviceName(), "FOCUSER_STATUS", "Status", MAIN_CONTROL_TAB, IPS_IDLE);
+    IUFillLight(&mStatusLights[0], "FOCUSER_FAULT_VALUE", "Motor Fault", IPS_IDLE);
+    IUFillLight(&mStatusLights[1], "FOCUSER_MISSED_STEP_VALUE", "Missed Step", IPS_IDLE);
+    IUFillLightVector(&mStatusLightProperty, mStatusLights, 2, getDeviceName(), "FOCUSER_STATUS", "Status", MAIN_CONTROL_TAB, IPS_IDLE);
+
+    // Reduce speed automatically when nHOME indicates a missed step
+    IUFillSwitch(&mSpeedBackoff[0], "BACKOFF_ENABLE", "Enable", ISS_ON);
+    IUFillSwitch(&mSpeedBackoff[1], "BACKOFF_DISABLE", "Disable", ISS_OFF);
+    IUFillSwitchVector(&mSpeedBackoffProperty, mSpeedBackoff, 2, getDeviceName(), "FOCUS_SPEED_BACKOFF", "Missed Step Backoff", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
 
     // Allow runtime adjustments to min/max absolute and relative travel limits
     IUFillNumber(&mMinMaxFocusPos[0], "MINPOS", "Minimum Position", "%6.0f", 0.0, 65000.0, 1000.0, DEFAULT_MIN_POSITION );
@@ -202,11 +231,13 @@ bool MUPAstroCAT::updateProperties()
     {
         defineLight(&mStatusLightProperty);
         defineNumber(&mMinMaxFocusPosProperty);
+        defineSwitch(&mSpeedBackoffProperty);
     }
     else
     {
         deleteProperty(mStatusLightProperty.name);
         deleteProperty(mMinMaxFocusPosProperty.name);
+        deleteProperty(mSpeedBackoffProperty.name);
     }
 
     return true;
@@ -219,6 +250,7 @@ bool MUPAstroCAT::saveConfigItems(FILE *fp)
     INDI::Focuser::saveConfigItems(fp);
 
     IUSaveConfigNumber(fp, &mMinMaxFocusPosProperty);
+    IUSaveConfigSwitch(fp, &mSpeedBackoffProperty);
 
     return true;
 }
@@ -231,6 +263,13 @@ bool MUPAstroCAT::ISNewNumber (const char *dev, const char *name, double values[
     // Property for this device?
     if (strcmp(dev, getDeviceName()) == 0)
     {
+        // Focus thread may reduce speed concurrently.
+        if (strcmp(name, FocusSpeedNP.name) == 0)
+        {
+            std::lock_guard<std::mutex> lock(mSpeedLock);
+            return INDI::Focuser::ISNewNumber(dev,name,values,names,n);
+        }
+
         if (strcmp(name, mMinMaxFocusPosProperty.name) == 0)
         {
             IUUpdateNumber(&mMinMaxFocusPosProperty, values, names, n);
@@ -253,8 +292,20 @@ bool MUPAstroCAT::ISNewNumber (const char *dev, const char *name, double values[
 // Client request to change a switch property
 bool MUPAstroCAT::ISNewSwitch (const char *dev, const char *name, ISState *states, char *names[], int n)
 {
-    // Check if it's a MUPAstroCAT property
-    // ...
+    // Property for this device?
+    if (strcmp(dev, getDeviceName()) == 0)
+    {
+        if (strcmp(name, mSpeedBackoffProperty.name) == 0)
+        {
+            std::lock_guard<std::mutex> lock(mSpeedLock);
+
+            IUUpdateSwitch(&mSpeedBackoffProperty, states, names, n);
+            mSpeedBackoffProperty.s = IPS_OK;
+            IDSetSwitch(&mSpeedBackoffProperty, nullptr);
+
+            return true;
+        }
+    }
 
     return INDI::Focuser::ISNewSwitch(dev,name,states,names,n);
 }
@@ -352,9 +403,9 @@ void MUPAstroCAT::_OnFaultStatusChanged()
 {
     const bool fault = mMotorController.hasFault();
 
-    if (fault != (mFaultLight.s == IPS_ALERT))
+    if (fault != (mStatusLights[0].s == IPS_ALERT))
     {
-        mFaultLight.s = fault ? IPS_ALERT : IPS_IDLE;
+        mStatusLights[0].s = fault ? IPS_ALERT : IPS_IDLE;
         IDSetLight(&mStatusLightProperty, nullptr);
     }
 }
@@ -371,20 +422,34 @@ void MUPAstroCAT::_ContinualFocusToTarget()
         std::unique_lock<std::mutex> lock(mFocusLock);
 
         // Avoid spurious wakeup
-        mCheckFocusCondition.wait(lock, [&]() {
+        const bool wake = mCheckFocusCondition.wait_for(lock, TELEMETRY_IDLE_PERIOD, [&]() {
                 return mFocusCurrentPosition != mFocusTargetPosition || mStopFocusThread;
              });
+
+        if (!wake)
+        {
+            _PublishTelemetry(false);
+            continue;
+        }
         
         FocusDirection focusDir = mFocusTargetPosition > mFocusCurrentPosition ? FOCUS_OUTWARD : FOCUS_INWARD;
         
         mMotorController.SetFocusDirection(focusDir == FOCUS_OUTWARD ? MotorController::FocusDirection::ANTI_CLOCKWISE : 
                                                                        MotorController::FocusDirection::CLOCKWISE);
 
+        if (mStatusLights[1].s == IPS_ALERT)
+        {
+            mStatusLights[1].s = IPS_IDLE;
+            IDSetLight(&mStatusLightProperty, nullptr);
+        }
+
         // TODO: Instead of single stepping could switch to a StepMotor(numSteps) call but to avoid
         //       blocking it would need thread moving into controller. In turn that means moving
         //       current and target pos tracking which in turn means moving the movement limits.
         //       Abort would then need moving and finally feedback of current position provided to this
         //       class in order to update the ui at a limited rate with a final update on completion/abort.
+        uint32_t reissuedSteps = 0;
+
         while (mFocusCurrentPosition != mFocusTargetPosition && !mStopFocusThread && !mFocusAbort)
         {
             mMotorController.StepMotor();
@@ -392,10 +457,27 @@ void MUPAstroCAT::_ContinualFocusToTarget()
             focusDir == FOCUS_OUTWARD ? mFocusCurrentPosition++ : mFocusCurrentPosition--;
             FocusAbsPosN[0].value = mFocusCurrentPosition;
             IDSetNumber(&FocusAbsPosNP, nullptr);
+            _PublishTelemetry(true);
 
             // Rough delay based on target steps per second.
-            std::this_thread::sleep_for(std::chrono::microseconds(1000000) / FocusSpeedN[0].value);
+            std::this_thread::sleep_for(std::chrono::microseconds(1000000) / _FocusSpeed());
+
+            // Dropped pulses are re-issued, position only lost if the indexer cannot be recovered.
+            switch (mMotorController.VerifyStepIndex())
+            {
+                case MotorController::StepVerification::OK:
+                    break;
+                case MotorController::StepVerification::CORRECTED:
+                    reissuedSteps++;
+                    break;
+                case MotorController::StepVerification::FAILED:
+                    _OnMissedStep();
+                    break;
+            }
         }
+
+        if (reissuedSteps > 0)
+            IDMessage(getDeviceName(), "Re-issued %" PRIu32 " STEP pulses not registered by the controller.", reissuedSteps);
         
         FocusAbsPosN[0].value = mFocusCurrentPosition;
         FocusAbsPosNP.s = IPS_OK;
@@ -412,9 +494,50 @@ void MUPAstroCAT::_ContinualFocusToTarget()
         //             would that mean (even though it's atomic) mFocusAbort can only be changed within
         //             the mFocusLock mutex? 
         mFocusTargetPosition = mFocusCurrentPosition;
+
+        _PublishTelemetry(false);
     }
 }
 
+void MUPAstroCAT::_OnMissedStep()
+{
+    mStatusLights[1].s = IPS_ALERT;
+    IDSetLight(&mStatusLightProperty, "Controller missed a STEP pulse near position %" PRIu32 ", position may be incorrect.", mFocusCurrentPosition);
+
+    std::lock_guard<std::mutex> lock(mSpeedLock);
+
+    if (mSpeedBackoff[0].s != ISS_ON)
+        return;
+
+    const double speed = std::max(FocusSpeedN[0].min, floor(FocusSpeedN[0].value * MISSED_STEP_SPEED_BACKOFF));
+    if (speed < FocusSpeedN[0].value)
+    {
+        FocusSpeedN[0].value = speed;
+        IDSetNumber(&FocusSpeedNP, "Focuser speed reduced to %g steps/second", speed);
+    }
+}
+
+// Requires mFocusLock
+void MUPAstroCAT::_PublishTelemetry(bool moving)
+{
+    Telemetry telemetry{};
+
+    telemetry.flags = TELEMETRY_CONNECTED;
+    if (moving)
+        telemetry.flags |= TELEMETRY_MOVING;
+    if (mMotorController.hasFault())
+        telemetry.flags |= TELEMETRY_FAULT;
+    if (mStatusLights[1].s == IPS_ALERT)
+        telemetry.flags |= TELEMETRY_MISSED_STEP;
+
+    telemetry.currentPosition = mFocusCurrentPosition;
+    telemetry.targetPosition = mFocusTargetPosition;
+    telemetry.speed = _FocusSpeed();
+    telemetry.temperature = NAN;
+
+    mTelemetryPublisher.Publish(telemetry);
+}
+
 bool MUPAstroCAT::_Disconnect()
 {
     AbortFocuser();
@@ -429,6 +552,17 @@ bool MUPAstroCAT::_Disconnect()
     if(mFocusThread.joinable()) 
         mFocusThread.join();
 
+    // Focus thread has exited, safe to publish the final state from here.
+    if (mTelemetryPublisher.isOpen())
+    {
+        Telemetry telemetry{};
+        telemetry.currentPosition = telemetry.targetPosition = mFocusCurrentPosition;
+        telemetry.speed = _FocusSpeed();
+        telemetry.temperature = NAN;
+        mTelemetryPublisher.Publish(telemetry);
+        mTelemetryPublisher.Close();
+    }
+
     MotorController::SetFaultChangeCallback(nullptr);
 
     mMotorController.Disable();
@@ -440,6 +574,12 @@ bool MUPAstroCAT::_Disconnect()
 // Private Properties
 //////////////////////////////////////////////////////////////////////
 
+double MUPAstroCAT::_FocusSpeed()
+{
+    std::lock_guard<std::mutex> lock(mSpeedLock);
+    return FocusSpeedN[0].value;
+}
+
 double MUPAstroCAT::_MinFocusPos() const
 {
     return mMinMaxFocusPos[0].value;
@@ -4,10 +4,12 @@
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <thread>
 
 #include "libindi/indifocuser.h"
 
 #include "motorcontroller.h"
+#include "telemetrypublisher.h"
 
 class MUPAstroCAT : public INDI::Focuser
 {
@@ -45,12 +47,15 @@ private:
     void _OnFaultStatusChanged(void);
 
 private:
-    ILight mFaultLight;
+    ILight mStatusLights[2];
     ILightVectorProperty  mStatusLightProperty;
+    ISwitch mSpeedBackoff[2];
+    ISwitchVectorProperty mSpeedBackoffProperty;
     INumber mMinMaxFocusPos[2];
     INumberVectorProperty mMinMaxFocusPosProperty;
 
     MotorController mMotorController;
+    TelemetryPublisher mTelemetryPublisher;
 
     std::mutex mFocusLock; // Used for: 
                            //  1 - mCheckFocusCondition
@@ -59,13 +64,19 @@ private:
     uint32_t mFocusTargetPosition = 0;
     uint32_t mFocusCurrentPosition = 0;
 
+    std::mutex mSpeedLock; // Used for FocusSpeedN and mSpeedBackoff, written by both INDI and focus threads.
+
     std::atomic<bool> mFocusAbort{ false };
     std::atomic<bool> mStopFocusThread{ false };
     std::thread mFocusThread;
 
     void _ContinualFocusToTarget();
+    void _OnMissedStep();
+    void _PublishTelemetry(bool moving);
     bool _Disconnect();
 
+    double _FocusSpeed();
+
     double _MinFocusPos() const;
     double _MaxFocusPos() const;
 };
@@ -0,0 +1,155 @@
+#pragma once
+
+// Layout of the focuser telemetry published to POSIX shared memory along with
+// helpers for local readers. The driver is the sole writer, updating the
+// segment under a seqlock: sequence is odd whilst an update is in progress and
+// incremented twice per update. Readers never block the writer.
+//
+// Usage:
+//     const TelemetrySegment *segment = OpenTelemetry();
+//     Telemetry snapshot;
+//     if (segment && ReadTelemetry(segment, snapshot) && IsTelemetryLive(snapshot)) ...
+//     CloseTelemetry(segment);
+//
+// The segment is removed on driver disconnect. Should the driver die the
+// segment remains but stops updating. A reader seeing IsTelemetryLive fail
+// should close and later re-open it.
+//
+// The driver publishes to TELEMETRY_SEGMENT_NAME unless overridden by the
+// MUPASTROCAT_TELEMETRY_SEGMENT environment variable, an empty value disables
+// publishing.
+
+#include <atomic>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+const char* const TELEMETRY_SEGMENT_NAME = "/mupastrocat_telemetry";
+const char* const TELEMETRY_SEGMENT_ENV = "MUPASTROCAT_TELEMETRY_SEGMENT";
+const uint32_t TELEMETRY_MAGIC = 0x5450554d; // "MUPT"
+const uint32_t TELEMETRY_VERSION = 1;
+
+// Driver publishes at least this often whilst idle and on every step whilst
+// moving (at least once a second at the minimum speed).
+const int64_t TELEMETRY_HEARTBEAT_US = 500000;
+const int64_t TELEMETRY_STALE_US = 4 * TELEMETRY_HEARTBEAT_US;
+
+enum TelemetryFlags : uint32_t {
+    TELEMETRY_CONNECTED   = 1 << 0,
+    TELEMETRY_MOVING      = 1 << 1,
+    TELEMETRY_FAULT       = 1 << 2,
+    TELEMETRY_MISSED_STEP = 1 << 3,
+};
+
+struct Telemetry {
+    uint32_t flags;             // TelemetryFlags
+    uint32_t currentPosition;   // steps
+    uint32_t targetPosition;    // steps
+    uint32_t reserved;
+    double speed;               // steps/second
+    double temperature;         // celsius, NaN until temperature support is added
+    int64_t monotonicTimeUs;    // CLOCK_MONOTONIC of last update
+    int64_t realTimeUs;         // CLOCK_REALTIME of last update
+};
+
+struct TelemetrySegment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              // sizeof(TelemetrySegment)
+    std::atomic<uint32_t> sequence;
+    int32_t ownerPid;           // publishing process
+    uint32_t reserved[3];
+    Telemetry telemetry;
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "Seqlock requires a lock free sequence counter.");
+static_assert(sizeof(Telemetry) == 48, "Telemetry layout changed, bump TELEMETRY_VERSION.");
+static_assert(sizeof(TelemetrySegment) == 80, "Telemetry layout changed, bump TELEMETRY_VERSION.");
+
+//////////////////////////////////////////////////////////////////////
+// Reader Helpers
+//////////////////////////////////////////////////////////////////////
+
+inline int64_t TelemetryClockMicroseconds(clockid_t clock = CLOCK_MONOTONIC)
+{
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Map the segment read only. Returns nullptr if the driver is not publishing,
+// is still creating the segment or the segment version does not match this
+// header.
+inline const TelemetrySegment* OpenTelemetry(const char *name = TELEMETRY_SEGMENT_NAME)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return nullptr;
+
+    // Segment is sized after creation, mapping beyond its end would SIGBUS.
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(TelemetrySegment)))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    void *addr = mmap(nullptr, sizeof(TelemetrySegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED)
+        return nullptr;
+
+    auto segment = static_cast<const TelemetrySegment*>(addr);
+    if (segment->magic != TELEMETRY_MAGIC || segment->version != TELEMETRY_VERSION ||
+        segment->size != sizeof(TelemetrySegment))
+    {
+        munmap(addr, sizeof(TelemetrySegment));
+        return nullptr;
+    }
+
+    return segment;
+}
+
+inline void CloseTelemetry(const TelemetrySegment *segment)
+{
+    if (segment)
+        munmap(const_cast<TelemetrySegment*>(segment), sizeof(TelemetrySegment));
+}
+
+// Single wait-free read attempt. Returns false if an update was in progress.
+inline bool TryReadTelemetry(const TelemetrySegment *segment, Telemetry &snapshot)
+{
+    const uint32_t sequence = segment->sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+        return false;
+
+    snapshot = segment->telemetry;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return segment->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+// Retry until a consistent snapshot is read. Updates take well under a
+// microsecond so a handful of attempts is plenty.
+inline bool ReadTelemetry(const TelemetrySegment *segment, Telemetry &snapshot, int attempts = 100)
+{
+    for (int i = 0; i < attempts; ++i)
+    {
+        if (TryReadTelemetry(segment, snapshot))
+            return true;
+    }
+
+    return false;
+}
+
+// False once the driver has disconnected or stopped updating the segment.
+inline bool IsTelemetryLive(const Telemetry &snapshot)
+{
+    return (snapshot.flags & TELEMETRY_CONNECTED) &&
+           TelemetryClockMicroseconds() - snapshot.monotonicTimeUs <= TELEMETRY_STALE_US;
+}
@@ -0,0 +1,160 @@
+/*
+    Shared memory telemetry publisher for the MUP Astro CAT focuser.
+
+    Copyright © 2016 Gary Preston (gary@mups.co.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    Notes:
+        - See telemetry.h for the segment layout and seqlock protocol.
+        - Segments are created exclusively so a second publisher (e.g. another
+          driver instance) cannot clobber or remove a live segment.
+*/
+
+#include <cerrno>
+#include <new>
+
+#include <signal.h>
+#include <sys/stat.h>
+
+#include "telemetrypublisher.h"
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+TelemetryPublisher::~TelemetryPublisher()
+{
+    Close();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+bool TelemetryPublisher::Open(const char *name)
+{
+    if (mSegment)
+        return true;
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && _RemoveStaleSegment(name))
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+
+    if (fd < 0)
+        return false;
+
+    if (ftruncate(fd, sizeof(TelemetrySegment)) != 0)
+    {
+        const int error = errno;
+        close(fd);
+        shm_unlink(name);
+        errno = error;
+        return false;
+    }
+
+    void *addr = mmap(nullptr, sizeof(TelemetrySegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int error = errno;
+    close(fd);
+
+    if (addr == MAP_FAILED)
+    {
+        shm_unlink(name);
+        errno = error;
+        return false;
+    }
+
+    // Version fields last so readers never accept a partially initialised segment.
+    mSegment = new (addr) TelemetrySegment();
+    mSegment->size = sizeof(TelemetrySegment);
+    mSegment->ownerPid = getpid();
+    mSegment->version = TELEMETRY_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    mSegment->magic = TELEMETRY_MAGIC;
+
+    mName = name;
+
+    return true;
+}
+
+void TelemetryPublisher::Close()
+{
+    if (!mSegment)
+        return;
+
+    munmap(mSegment, sizeof(TelemetrySegment));
+    shm_unlink(mName.c_str());
+    mSegment = nullptr;
+}
+
+bool TelemetryPublisher::isOpen() const
+{
+    return mSegment != nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void TelemetryPublisher::Publish(Telemetry telemetry)
+{
+    if (!mSegment)
+        return;
+
+    telemetry.monotonicTimeUs = TelemetryClockMicroseconds(CLOCK_MONOTONIC);
+    telemetry.realTimeUs = TelemetryClockMicroseconds(CLOCK_REALTIME);
+
+    // Odd sequence marks the update in progress.
+    const uint32_t sequence = mSegment->sequence.load(std::memory_order_relaxed);
+    mSegment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    mSegment->telemetry = telemetry;
+
+    mSegment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Private
+//////////////////////////////////////////////////////////////////////
+
+// Unlink an existing segment if its owner is no longer running. Sets errno
+// EBUSY and returns false if the segment is in use.
+bool TelemetryPublisher::_RemoveStaleSegment(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return errno == ENOENT; // Removed in the meantime
+
+    pid_t owner = 0;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(TelemetrySegment)))
+    {
+        void *addr = mmap(nullptr, sizeof(TelemetrySegment), PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            auto segment = static_cast<const TelemetrySegment*>(addr);
+            if (segment->magic == TELEMETRY_MAGIC)
+                owner = segment->ownerPid;
+            munmap(addr, sizeof(TelemetrySegment));
+        }
+    }
+    close(fd);
+
+    // EPERM means the owner exists but belongs to another user.
+    if (owner > 0 && (kill(owner, 0) == 0 || errno == EPERM))
+    {
+        errno = EBUSY;
+        return false;
+    }
+
+    return shm_unlink(name) == 0 || errno == ENOENT;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+#include "telemetry.h"
+
+// Publish focuser telemetry to POSIX shared memory for co-located readers.
+// Publish must only be called from a single thread.
+class TelemetryPublisher {
+
+public:
+    TelemetryPublisher() = default;
+    ~TelemetryPublisher();
+
+    TelemetryPublisher(const TelemetryPublisher&) = delete;
+    TelemetryPublisher& operator=(const TelemetryPublisher&) = delete;
+
+    // Create and map the segment. A segment left by a process that has since
+    // died is replaced, one owned by a live process is not (errno EBUSY).
+    // Returns false on failure in which case Publish is a no-op.
+    bool Open(const char *name = TELEMETRY_SEGMENT_NAME);
+    // Unmap and remove the segment.
+    void Close();
+
+    bool isOpen() const;
+
+    // Timestamps are filled in by the publisher.
+    void Publish(Telemetry telemetry);
+
+private:
+    bool _RemoveStaleSegment(const char *name);
+
+private:
+    TelemetrySegment* mSegment = nullptr;
+    std::string mName;
+};